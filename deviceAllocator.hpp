@@ -0,0 +1,215 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "subAllocators.hpp"
+
+struct DeviceAllocation {
+	vk::DeviceMemory memory;
+	vk::DeviceSize offset {0};
+	vk::DeviceSize size {0};
+	std::byte* mappedData {nullptr};	// Already offset. Only set for host visible memory, which stays mapped
+	void* block {nullptr};				// The block the allocation comes from, nullptr for dedicated allocations
+};
+
+// Reserves big vk::DeviceMemory blocks for each memory type and hands out pieces of them,
+// so that the number of vkAllocateMemory calls stays far below maxMemoryAllocationCount
+class DeviceAllocator {
+public:
+	struct Statistics {
+		vk::DeviceSize reservedBytes {0};	// Sum of all the vk::DeviceMemory sizes
+		vk::DeviceSize usedBytes {0};		// Sum of the sizes handed out (rounded up to the block sizes)
+		uint32_t deviceMemoryCount {0};
+		uint32_t allocationCount {0};
+		double fragmentation {0.0};			// 0 when all the free space is contiguous, close to 1 when it's split in tiny pieces
+	};
+
+	static constexpr vk::DeviceSize defaultBlockSize {64 * 1024 * 1024};
+
+	void init(const vk::PhysicalDevice physicalDevice, const vk::Device device, const vk::DeviceSize preferredBlockSize = defaultBlockSize) {
+		this->device = device;
+		memoryProperties = physicalDevice.getMemoryProperties();
+		const vk::PhysicalDeviceLimits limits {physicalDevice.getProperties().limits};
+		bufferImageGranularity = limits.bufferImageGranularity;
+		maxMemoryAllocationCount = limits.maxMemoryAllocationCount;
+		blockSizes.resize(memoryProperties.memoryTypeCount);
+		for (uint32_t i {0}; i < memoryProperties.memoryTypeCount; ++i) {
+			// Small heaps (like the 256 MiB host visible device local one) shouldn't be taken up by a single block
+			const vk::DeviceSize heapSize {memoryProperties.memoryHeaps[memoryProperties.memoryTypes[i].heapIndex].size};
+			blockSizes[i] = std::bit_floor(std::min(preferredBlockSize, heapSize / 8));
+		}
+		pools.resize(memoryProperties.memoryTypeCount * 2);
+	}
+
+	void destroy() {
+		for (auto& pool : pools) {
+			for (const auto& block : pool) {
+				device.freeMemory(block->memory);	// Also unmaps it
+			}
+			pool.clear();
+		}
+		for (const auto& [memory, size] : dedicatedAllocations) {
+			device.freeMemory(vk::DeviceMemory(memory));
+		}
+		dedicatedAllocations.clear();
+	}
+
+	[[nodiscard]] DeviceAllocation allocate(const vk::MemoryRequirements& requirements, const vk::MemoryPropertyFlags properties, const ResourceKind kind) {
+		const std::lock_guard lock(mutex);
+		const uint32_t memoryType {findMemoryType(requirements.memoryTypeBits, properties)};
+		const vk::DeviceSize blockSize {blockSizes[memoryType]};
+
+		// Something this big would waste most of a block anyway. An alignment that big would too, a dedicated allocation
+		// starts at 0 so it's aligned to anything
+		if (std::max(requirements.size, requirements.alignment) > blockSize / 2) {
+			const vk::DeviceMemory memory {allocateDeviceMemory(requirements.size, memoryType)};
+			dedicatedAllocations.emplace(static_cast<VkDeviceMemory>(memory), requirements.size);
+			return DeviceAllocation {memory, 0, requirements.size, map(memory, memoryType), nullptr};
+		}
+
+		auto& pool {pools[poolIndex(memoryType, bufferImageGranularity, kind)]};
+		for (const auto& block : pool) {
+			if (const std::optional offset {block->allocator.allocate(requirements.size, requirements.alignment)}) {
+				return makeAllocation(*block, *offset, requirements.size);
+			}
+		}
+		const vk::DeviceMemory memory {allocateDeviceMemory(blockSize, memoryType)};
+		pool.push_back(std::make_unique<Block>(Block {memory, map(memory, memoryType), BuddyAllocator(blockSize, minAllocationSize)}));
+		Block& block {*pool.back()};
+		const std::optional offset {block.allocator.allocate(requirements.size, requirements.alignment)};
+		if (!offset) {
+			throw std::runtime_error("Failed to allocate " + std::to_string(requirements.size) + " bytes aligned to " + std::to_string(requirements.alignment) + " in a new memory block");
+		}
+		return makeAllocation(block, *offset, requirements.size);
+	}
+
+	[[nodiscard]] DeviceAllocation allocateAndBind(const vk::Buffer buffer, const vk::MemoryPropertyFlags properties) {
+		const DeviceAllocation allocation {allocate(device.getBufferMemoryRequirements(buffer), properties, ResourceKind::eLinear)};
+		device.bindBufferMemory(buffer, allocation.memory, allocation.offset);
+		return allocation;
+	}
+
+	[[nodiscard]] DeviceAllocation allocateAndBind(const vk::Image image, const vk::MemoryPropertyFlags properties, const ResourceKind kind = ResourceKind::eOptimal) {
+		const DeviceAllocation allocation {allocate(device.getImageMemoryRequirements(image), properties, kind)};
+		device.bindImageMemory(image, allocation.memory, allocation.offset);
+		return allocation;
+	}
+
+	void free(const DeviceAllocation& allocation) {
+		const std::lock_guard lock(mutex);
+		if (!allocation.block) {
+			dedicatedAllocations.erase(static_cast<VkDeviceMemory>(allocation.memory));
+			device.freeMemory(allocation.memory);
+			--deviceMemoryCount;
+			return;
+		}
+		Block& block {*static_cast<Block*>(allocation.block)};
+		block.allocator.free(allocation.offset);
+		--allocationCount;
+		if (block.allocator.empty()) {
+			releaseIfSpare(block);
+		}
+	}
+
+	[[nodiscard]] Statistics statistics() const {
+		const std::lock_guard lock(mutex);
+		Statistics statistics;
+		vk::DeviceSize freeBytes {0};
+		vk::DeviceSize largestFreeBlock {0};
+		for (const auto& pool : pools) {
+			for (const auto& block : pool) {
+				statistics.reservedBytes += block->allocator.size();
+				statistics.usedBytes += block->allocator.usedBytes();
+				freeBytes += block->allocator.size() - block->allocator.usedBytes();
+				largestFreeBlock = std::max(largestFreeBlock, block->allocator.largestFreeBlock());
+			}
+		}
+		for (const auto& [memory, size] : dedicatedAllocations) {
+			statistics.reservedBytes += size;
+			statistics.usedBytes += size;
+		}
+		statistics.deviceMemoryCount = deviceMemoryCount;
+		statistics.allocationCount = allocationCount + static_cast<uint32_t>(dedicatedAllocations.size());
+		statistics.fragmentation = freeBytes == 0 ? 0.0 : 1.0 - static_cast<double>(largestFreeBlock) / static_cast<double>(freeBytes);
+		return statistics;
+	}
+
+	[[nodiscard]] uint32_t findMemoryType(const uint32_t memoryTypeBits, const vk::MemoryPropertyFlags properties) const {
+		for (uint32_t i {0}; i < memoryProperties.memoryTypeCount; ++i) {
+			// memoryTypeBits has a bit set for every memory type that the resource can use
+			if ((memoryTypeBits & (1U << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+				return i;
+			}
+		}
+		throw std::runtime_error("Failed to find a suitable memory type");
+	}
+
+private:
+	static constexpr vk::DeviceSize minAllocationSize {256};
+
+	struct Block {
+		vk::DeviceMemory memory;
+		std::byte* mappedData;
+		BuddyAllocator allocator;
+	};
+
+	vk::Device device;
+	vk::PhysicalDeviceMemoryProperties memoryProperties;
+	vk::DeviceSize bufferImageGranularity {1};
+	uint32_t maxMemoryAllocationCount {0};
+	uint32_t deviceMemoryCount {0};
+	uint32_t allocationCount {0};
+	std::vector<vk::DeviceSize> blockSizes;						// By memory type
+	std::vector<std::vector<std::unique_ptr<Block>>> pools;		// Two for each memory type, one for each ResourceKind
+	std::unordered_map<VkDeviceMemory, vk::DeviceSize> dedicatedAllocations;
+	mutable std::mutex mutex;
+
+	[[nodiscard]] vk::DeviceMemory allocateDeviceMemory(const vk::DeviceSize size, const uint32_t memoryType) {
+		if (deviceMemoryCount == maxMemoryAllocationCount) {
+			throw std::runtime_error("Reached maxMemoryAllocationCount");
+		}
+		const vk::DeviceMemory memory {device.allocateMemory(vk::MemoryAllocateInfo(size, memoryType))};
+		++deviceMemoryCount;
+		return memory;
+	}
+
+	// Host visible memory gets mapped once and stays mapped: mapping the same memory twice isn't allowed,
+	// and mapping and unmapping all the time isn't free either
+	[[nodiscard]] std::byte* map(const vk::DeviceMemory memory, const uint32_t memoryType) const {
+		if (!(memoryProperties.memoryTypes[memoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)) {
+			return nullptr;
+		}
+		return static_cast<std::byte*>(device.mapMemory(memory, 0, VK_WHOLE_SIZE));
+	}
+
+	[[nodiscard]] DeviceAllocation makeAllocation(Block& block, const vk::DeviceSize offset, const vk::DeviceSize size) {
+		++allocationCount;
+		return DeviceAllocation {block.memory, offset, size, block.mappedData ? block.mappedData + offset : nullptr, &block};
+	}
+
+	// Empty blocks are given back to the driver, but I keep the last one of each pool so that allocating
+	// and freeing something in a loop doesn't allocate device memory every time
+	void releaseIfSpare(Block& block) {
+		for (auto& pool : pools) {
+			const auto found {std::find_if(pool.begin(), pool.end(), [&block](const auto& candidate) { return candidate.get() == &block; })};
+			if (found == pool.end()) {
+				continue;
+			}
+			if (pool.size() > 1) {
+				device.freeMemory(block.memory);
+				--deviceMemoryCount;
+				pool.erase(found);
+			}
+			return;
+		}
+	}
+};
@@ -11,7 +11,10 @@
 #include <set>
 #include <limits>
 #include "new.hpp"
+#include "deviceAllocator.hpp"
 #include <fstream>
+#include <filesystem>
+#include <chrono>
 
 #ifdef NDEBUG
     static constexpr bool enableValidationLayers = false;
@@ -21,6 +24,7 @@
 
 static constexpr std::array validationLayers {"VK_LAYER_KHRONOS_validation"};
 static constexpr std::array requestedPhysicalDeviceExtensions {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+static constexpr std::string_view pipelineCacheFileName {"pipeline_cache.bin"};
 
 VkResult createDebugUtilsMessengerEXT(
 	const vk::Instance instance,
@@ -44,10 +48,35 @@ void destroydebugUtilsMessengerEXT(const vk::Instance instance, vk::DebugUtilsMe
 	}
 }
 
+VkResult createHeadlessSurfaceEXT(
+	const vk::Instance instance,
+	const vk::HeadlessSurfaceCreateInfoEXT* pCreateInfo,
+	const vk::AllocationCallbacks* pAllocator,
+	vk::SurfaceKHR* pSurface
+) {
+	auto createHeadlessSurfaceFunc {reinterpret_cast<PFN_vkCreateHeadlessSurfaceEXT>(instance.getProcAddr("vkCreateHeadlessSurfaceEXT"))};
+	if (createHeadlessSurfaceFunc) {
+		return createHeadlessSurfaceFunc(instance, reinterpret_cast<const VkHeadlessSurfaceCreateInfoEXT*>(pCreateInfo), reinterpret_cast<const VkAllocationCallbacks*>(pAllocator), reinterpret_cast<VkSurfaceKHR*>(pSurface));
+	}
+	else {
+		return VK_ERROR_EXTENSION_NOT_PRESENT;
+	}
+}
+
+struct Options {
+	bool headless {false};			// No window: render to VK_EXT_headless_surface if available, to offscreen images otherwise
+	uint32_t frameCount {1000};		// Only used in headless mode, where there's no window to close
+	uint32_t framesInFlight {2};	// How many frames the CPU can record while the GPU is still working on the previous ones
+};
+
 class HelloTriangleApplication {
 public:
+	explicit HelloTriangleApplication(const Options& options) : options(options) {}
+
 	void run() {
-		initWindow();
+		if (!options.headless) {
+			initWindow();
+		}
 		initVulkan();
 		mainLoop();
 		cleanup();
@@ -56,27 +85,68 @@ public:
 private:
 	static constexpr uint32_t windowWidth = 1280;
 	static constexpr uint32_t windowHeight = 720;
-	GLFWwindow* window;
+	static constexpr uint32_t offscreenImageCount = 3;	// Stand-ins for the swapchain images when there's no surface at all
+	const Options options;
+	GLFWwindow* window {nullptr};						// Stays nullptr in headless mode
 	vk::Instance instance;
 	vk::DebugUtilsMessengerEXT debugMessenger;
 	vk::PhysicalDevice physicalDevice;
 	vk::Device device;
+	DeviceAllocator deviceAllocator;				// Every buffer and image gets its memory from here
 	vk::Queue graphicsQueue;						// Automatically cleaned up when destroying device
 	vk::Queue presentationQueue;
-	vk::SurfaceKHR surface;							// Basically the window
+	bool useHeadlessSurface {false};
+	vk::SurfaceKHR surface;							// Basically the window. Null when rendering headless without VK_EXT_headless_surface
 	vk::SwapchainKHR swapchain;
 	std::vector<vk::Image> swapchainImages;			// Here I'll store the images in the swapchain. Automatically cleaned up when destroyng the swapchain
+	std::vector<DeviceAllocation> offscreenImageMemory;	// Only used when swapchainImages are offscreen images that I created myself
 	vk::Format swapchainImageFormat;
 	vk::Extent2D swapchainExtent;
 	std::vector<vk::ImageView> swapchainImageViews;	// Necessary to visualize the vk::Images
+	vk::PipelineCache pipelineCache;				// Saved to disk in cleanup(), so that the next launch doesn't have to compile the shaders again
+	bool pipelineCacheLoaded {false};
+	vk::RenderPass renderPass;
 	vk::PipelineLayout pipelineLayout;
+	vk::Pipeline graphicsPipeline;
+	std::vector<vk::Framebuffer> swapchainFramebuffers;
+
+	// Everything that a frame needs while it's being recorded and executed. Having one of these for each
+	// frame in flight lets me record the next frame while the GPU is still busy with the previous one
+	struct FrameResources {
+		vk::CommandPool commandPool;				// One pool per frame, so that I can reset it as a whole
+		vk::CommandBuffer commandBuffer;
+		vk::Semaphore imageAvailableSemaphore;		// Signaled when the swapchain image can be rendered to
+		vk::Semaphore renderFinishedSemaphore;		// Signaled when rendering is done and the image can be presented
+		vk::Fence inFlightFence;					// Signaled when the GPU is done with this frame
+	};
+	std::vector<FrameResources> frames;
+	size_t currentFrame {0};
+	std::vector<vk::Fence> imagesInFlight;			// Fence of the frame that last used each swapchain image, null if none did
+	uint32_t nextOffscreenImage {0};
+	uint64_t frameNumber {0};						// Number of frames submitted so far
+	bool framebufferResized {false};				// Set by the GLFW callback, not every platform reports eErrorOutOfDateKHR on resize
+
+	// What's left of a swapchain after it gets replaced. Frames that are still in flight may be using it,
+	// so instead of waiting for the device to be idle I destroy it once all those frames are done
+	struct RetiredSwapchain {
+		vk::SwapchainKHR swapchain;
+		std::vector<vk::ImageView> imageViews;
+		std::vector<vk::Framebuffer> framebuffers;
+		uint64_t retiredAtFrame;
+	};
+	std::vector<RetiredSwapchain> retiredSwapchains;
 
 private:
 	void initWindow() {
 		glfwInit();
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
 		window = glfwCreateWindow(windowWidth, windowHeight, "Vulkan", nullptr, nullptr);
+		glfwSetWindowUserPointer(window, this);
+		glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+	}
+
+	static void framebufferResizeCallback(GLFWwindow* const window, const int /*width*/, const int /*height*/) {
+		static_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window))->framebufferResized = true;
 	}
 
 	void initVulkan() {
@@ -85,31 +155,65 @@ private:
 		createSurface();
 		pickPhysicalDevice();
 		createLogicalDevice();
+		createPipelineCache();
 		createSwapchain();
 		createImageViews();
+		createRenderPass();
 		createGraphicsPipeline();
+		createFramebuffers();
+		createFrameResources();
 	}
 
 	void mainLoop() {
-		while (!glfwWindowShouldClose(window)) {
-			glfwPollEvents();
+		if (window) {
+			while (!glfwWindowShouldClose(window)) {
+				glfwPollEvents();
+				drawFrame();
+			}
 		}
+		else {
+			for (uint32_t i {0}; i < options.frameCount; ++i) {
+				drawFrame();
+			}
+		}
+		// The last frames could still be in flight, and I can't destroy what they're using
+		device.waitIdle();
 	}
 
 	void cleanup() {
-		device.destroyPipelineLayout(pipelineLayout);
-		for (auto imageView : swapchainImageViews) {
-			device.destroyImageView(imageView);
+		for (const FrameResources& frame : frames) {
+			device.destroyFence(frame.inFlightFence);
+			device.destroySemaphore(frame.renderFinishedSemaphore);
+			device.destroySemaphore(frame.imageAvailableSemaphore);
+			device.destroyCommandPool(frame.commandPool);	// Frees its command buffers too
+		}
+		destroyRetiredSwapchains(std::numeric_limits<uint64_t>::max());
+		destroySwapchainResources(swapchain, swapchainImageViews, swapchainFramebuffers);
+		if (!swapchain) {
+			for (size_t i {0}; i < swapchainImages.size(); ++i) {
+				device.destroyImage(swapchainImages[i]);
+				deviceAllocator.free(offscreenImageMemory[i]);
+			}
 		}
-		device.destroySwapchainKHR(swapchain);
+		device.destroyPipeline(graphicsPipeline);
+		device.destroyPipelineLayout(pipelineLayout);
+		device.destroyRenderPass(renderPass);
+		savePipelineCache();
+		device.destroyPipelineCache(pipelineCache);
+		printDeviceMemoryStatistics();
+		deviceAllocator.destroy();
 		device.destroy();
 		if constexpr (enableValidationLayers) {
 			destroydebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
 		}
-		instance.destroySurfaceKHR(surface);
+		if (surface) {
+			instance.destroySurfaceKHR(surface);
+		}
 		instance.destroy();
-		glfwDestroyWindow(window);
-		glfwTerminate();
+		if (window) {
+			glfwDestroyWindow(window);
+			glfwTerminate();
+		}
 	}
 
 	void createInstance() {
@@ -198,7 +302,21 @@ private:
 		return true;
 	}
 
-	[[nodiscard]] static std::vector<const char*> getRequiredExtensions() {
+	[[nodiscard]] std::vector<const char*> getRequiredExtensions() {
+		if (options.headless) {
+			std::vector<const char*> extensions;
+			// With a headless surface I can still use a real swapchain, otherwise I'll have to render to my own images
+			useHeadlessSurface = isInstanceExtensionAvailable(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+			if (useHeadlessSurface) {
+				extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+				extensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+			}
+			if constexpr (enableValidationLayers) {
+				extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+			}
+			return extensions;
+		}
+
 		uint32_t glfwExtensionCount;
 		const char** const glfwExtensions {glfwGetRequiredInstanceExtensions(&glfwExtensionCount)};
 		// TODO: Test vector on Windows
@@ -209,6 +327,13 @@ private:
 		return extensions;
 	}
 
+	[[nodiscard]] static bool isInstanceExtensionAvailable(const std::string_view extensionName) {
+		const std::vector availableExtensions {vk::enumerateInstanceExtensionProperties()};
+		return std::any_of(availableExtensions.begin(), availableExtensions.end(), [extensionName](const vk::ExtensionProperties& extension) {
+			return extensionName == extension.extensionName.data();
+		});
+	}
+
 	static VKAPI_ATTR vk::Bool32 VKAPI_CALL debugCallback(
 		const VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
 		const VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -254,6 +379,10 @@ private:
 	}
 
 	[[nodiscard]] bool isPhysicalDeviceSuitable(const vk::PhysicalDevice physicalDevice) const {
+		if (!surface) {
+			// Offscreen rendering only needs a graphics queue, no swapchain
+			return findQueueFamilies(physicalDevice).isComplete();
+		}
 		return findQueueFamilies(physicalDevice).isComplete() &&
 			   checkPhysicalDeviceExtensionSupport(physicalDevice) &&
 			   querySwapchainSupport(physicalDevice).isAdequate();
@@ -278,9 +407,15 @@ private:
 				indices.graphicsFamily = i;
 			}
 			// If the queue at that index supports presentation, I insert its index in the presentationFamily part of the QueueFamilyIndices
-			const vk::Bool32 presentationSupport {physicalDevice.getSurfaceSupportKHR(i, surface)};
-			if (presentationSupport) {
-				indices.presentationFamily = i;
+			if (surface) {
+				const vk::Bool32 presentationSupport {physicalDevice.getSurfaceSupportKHR(i, surface)};
+				if (presentationSupport) {
+					indices.presentationFamily = i;
+				}
+			}
+			else {
+				// Nothing gets presented, so the graphics queue can stand in for the presentation one
+				indices.presentationFamily = indices.graphicsFamily;
 			}
 			// The two indices don't have to always be the same
 			if (indices.isComplete()) {
@@ -318,15 +453,33 @@ private:
 					}
 					else return nullptr;
 				}(),
-				requestedPhysicalDeviceExtensions.size(), requestedPhysicalDeviceExtensions.data(),
+				surface ? requestedPhysicalDeviceExtensions.size() : 0,	// Without a surface there's no swapchain
+				surface ? requestedPhysicalDeviceExtensions.data() : nullptr,
 				&physicalDeviceFeatures
 			)
 		);
 		graphicsQueue = device.getQueue(indices.graphicsFamily.value(), 0);
 		presentationQueue = device.getQueue(indices.presentationFamily.value(), 0);
+		deviceAllocator.init(physicalDevice, device);
+	}
+
+	void printDeviceMemoryStatistics() const {
+		const DeviceAllocator::Statistics statistics {deviceAllocator.statistics()};
+		std::clog << "Device memory: " << statistics.usedBytes << " of " << statistics.reservedBytes << " bytes used, "
+				  << statistics.allocationCount << " allocations in " << statistics.deviceMemoryCount << " vk::DeviceMemory, "
+				  << statistics.fragmentation * 100.0 << "% fragmentation\n";
 	}
 
 	void createSurface() {
+		if (options.headless) {
+			if (useHeadlessSurface) {
+				const vk::HeadlessSurfaceCreateInfoEXT headlessSurfaceCreateInfo;
+				if (createHeadlessSurfaceEXT(instance, &headlessSurfaceCreateInfo, nullptr, &surface) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to create headless surface");
+				}
+			}
+			return;
+		}
 		if (glfwCreateWindowSurface(instance, window, nullptr, reinterpret_cast<VkSurfaceKHR*>(&surface)) != VK_SUCCESS) {	// I think I can safely cast, the C++ wrapper and the original C struct should have the same size
 			//vk::SurfaceKHR member_surface(temp_VkSurfaceKHR); To test if the above doesn't work
 			throw std::runtime_error("Failed to create window surface");
@@ -387,20 +540,30 @@ private:
 		return vk::PresentModeKHR::eFifo;	// Guaranteed to be available, is v-sync
 	}
 
-	[[nodiscard]] static vk::Extent2D chooseSwapExtent(const vk::SurfaceCapabilitiesKHR& capabilities) {
+	[[nodiscard]] vk::Extent2D chooseSwapExtent(const vk::SurfaceCapabilitiesKHR& capabilities) const {
 		if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
 			return capabilities.currentExtent;
 		}
 		else {
-			//vk::Extent2D actualExtent {windowWidth, windowHeight};
-			//actualExtent.width = std::max(capabilities.minImageExtent.width, std::min(capabilities.maxImageExtent.width, actualExtent.width));
-			//actualExtent.height = std::max(capabilities.minImageExtent.height, std::min(capabilities.maxImageExtent.height, actualExtent.height));
-			// TODO: Check if the line below works
-			return vk::Extent2D(std::max(capabilities.minImageExtent.width, std::min(capabilities.maxImageExtent.width, windowWidth)), std::max(capabilities.minImageExtent.height, std::min(capabilities.maxImageExtent.height, windowHeight)));
+			// The surface lets me pick the size, so I follow the framebuffer (which changes when the window gets resized)
+			vk::Extent2D framebufferExtent(windowWidth, windowHeight);
+			if (window) {
+				int width, height;
+				glfwGetFramebufferSize(window, &width, &height);
+				framebufferExtent = vk::Extent2D(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+			}
+			return vk::Extent2D(
+				std::clamp(framebufferExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width),
+				std::clamp(framebufferExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height)
+			);
 		}
 	}
 
 	void createSwapchain() {
+		if (!surface) {
+			createOffscreenImages();
+			return;
+		}
 		const SwapchainDetails swapchainDetails {querySwapchainSupport(physicalDevice)};
 		const vk::SurfaceFormatKHR surfaceFormat {chooseSwapSurfaceFormat(swapchainDetails.formats)};
 		const vk::Extent2D extent {chooseSwapExtent(swapchainDetails.capabilities)};
@@ -423,18 +586,18 @@ private:
 			vk::CompositeAlphaFlagBitsKHR::eOpaque,				// Specifies if the alpha channel should be used for blending with other windows. This way I just ignore it
 			chooseSwapPresentMode(swapchainDetails.presentModes),
 			true,												// Enable clipping for best performance, but I'm unable to see the pixels obscured by a window on top
-			{/*oldSwapchain*/}
+			swapchain											// The swapchain I'm replacing, if any. The driver can reuse its resources
 		);
 
 		const QueueFamilyIndices indices {findQueueFamilies(physicalDevice)};
+		// Has to live until device.createSwapchainKHR(swapchainCreateInfo) gets called
+		const std::array queueFamilyIndices {indices.graphicsFamily.value(), indices.presentationFamily.value()};
 		// If I have two different queues they'll be able to access the image at the same time.
 		// This way, I have to specify which families will be using the swapchain
 		if (indices.graphicsFamily.value() != indices.presentationFamily.value()) {
-			//const std::array queueFamilyIndices {indices.graphicsFamily.value(), indices.presentationFamily.value()};
 			swapchainCreateInfo.imageSharingMode = vk::SharingMode::eConcurrent;
-			swapchainCreateInfo.queueFamilyIndexCount = 2;
-			// TODO: Probably the scope of the std::array must be the same as when device.createSwapchainKHR(swapchainCreateInfo) gets called
-			swapchainCreateInfo.pQueueFamilyIndices = std::array{indices.graphicsFamily.value(), indices.presentationFamily.value()}.data();
+			swapchainCreateInfo.queueFamilyIndexCount = queueFamilyIndices.size();
+			swapchainCreateInfo.pQueueFamilyIndices = queueFamilyIndices.data();
 		}
 		
 		swapchain = device.createSwapchainKHR(swapchainCreateInfo);
@@ -443,6 +606,80 @@ private:
 		swapchainExtent = extent;
 	}
 	
+	// Called when the swapchain doesn't match the surface anymore, usually because the window got resized.
+	// Only what depends on the extent gets created again: the render pass and the pipeline stay the same,
+	// since the surface format doesn't change and the viewport and scissor are dynamic states
+	void recreateSwapchain() {
+		if (window) {
+			// A minimized window has a 0x0 framebuffer, and a swapchain can't be that small. I wait until it's visible again
+			int width, height;
+			glfwGetFramebufferSize(window, &width, &height);
+			while (width == 0 || height == 0) {
+				glfwWaitEvents();
+				glfwGetFramebufferSize(window, &width, &height);
+			}
+		}
+		framebufferResized = false;
+
+		RetiredSwapchain retiredSwapchain {swapchain, std::move(swapchainImageViews), std::move(swapchainFramebuffers), frameNumber};
+		createSwapchain();	// Passes the current swapchain as oldSwapchain
+		retiredSwapchains.push_back(std::move(retiredSwapchain));
+		createImageViews();
+		createFramebuffers();
+		imagesInFlight.assign(swapchainImages.size(), nullptr);
+	}
+
+	// Frame slots are reused in order and each one waits on its fence first, so once framesInFlight more frames
+	// have been started after a swapchain was retired, every frame that could have used it is done
+	void destroyRetiredSwapchains(const uint64_t completedFrame) {
+		std::erase_if(retiredSwapchains, [this, completedFrame](const RetiredSwapchain& retired) {
+			if (retired.retiredAtFrame + frames.size() > completedFrame) {
+				return false;
+			}
+			destroySwapchainResources(retired.swapchain, retired.imageViews, retired.framebuffers);
+			return true;
+		});
+	}
+
+	void destroySwapchainResources(const vk::SwapchainKHR swapchain, const std::vector<vk::ImageView>& imageViews, const std::vector<vk::Framebuffer>& framebuffers) const {
+		for (auto framebuffer : framebuffers) {
+			device.destroyFramebuffer(framebuffer);
+		}
+		for (auto imageView : imageViews) {
+			device.destroyImageView(imageView);
+		}
+		if (swapchain) {
+			device.destroySwapchainKHR(swapchain);	// Also destroys its images
+		}
+	}
+
+	// Used instead of the swapchain when there's no surface. The images are used exactly like the swapchain ones,
+	// but they stay in eTransferSrcOptimal at the end of the render pass, ready to be read back
+	void createOffscreenImages() {
+		swapchainImageFormat = vk::Format::eR8G8B8A8Srgb;	// Mandatory format for color attachments, so it's always supported
+		swapchainExtent = vk::Extent2D(windowWidth, windowHeight);
+		swapchainImages.resize(offscreenImageCount);
+		offscreenImageMemory.resize(offscreenImageCount);
+
+		for (size_t i {0}; i < swapchainImages.size(); ++i) {
+			swapchainImages[i] = device.createImage(
+				vk::ImageCreateInfo({},
+					vk::ImageType::e2D,
+					swapchainImageFormat,
+					vk::Extent3D(swapchainExtent, 1),
+					/*mipLevels*/ 1, /*arrayLayers*/ 1,
+					vk::SampleCountFlagBits::e1,
+					vk::ImageTiling::eOptimal,
+					vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+					vk::SharingMode::eExclusive,
+					{/*queueFamilyIndexCount*/}, {/*pQueueFamilyIndices*/},
+					vk::ImageLayout::eUndefined
+				)
+			);
+			offscreenImageMemory[i] = deviceAllocator.allocateAndBind(swapchainImages[i], vk::MemoryPropertyFlagBits::eDeviceLocal);
+		}
+	}
+
 	void createImageViews() {
 		swapchainImageViews.resize(swapchainImages.size());
 
@@ -465,14 +702,91 @@ private:
 		}
 	}
 
+	void createPipelineCache() {
+		std::vector<std::byte> initialData;
+		if (std::filesystem::exists(pipelineCacheFileName)) {
+			initialData = readFile(pipelineCacheFileName);
+			// A cache written by another GPU or driver version would be rejected (or worse) by the driver, so I check it myself
+			if (!isPipelineCacheCompatible(initialData, physicalDevice.getProperties())) {
+				std::clog << "Discarding the pipeline cache, it was created by a different device or driver\n";
+				initialData.clear();
+			}
+		}
+		pipelineCache = device.createPipelineCache(vk::PipelineCacheCreateInfo({}, initialData.size(), initialData.data()));
+		pipelineCacheLoaded = !initialData.empty();
+	}
+
+	[[nodiscard]] static bool isPipelineCacheCompatible(const std::vector<std::byte>& cacheData, const vk::PhysicalDeviceProperties& properties) {
+		// Layout of VkPipelineCacheHeaderVersionOne, which is at the start of every cache blob
+		struct PipelineCacheHeader {
+			uint32_t headerSize;
+			uint32_t headerVersion;
+			uint32_t vendorID;
+			uint32_t deviceID;
+			std::array<uint8_t, VK_UUID_SIZE> pipelineCacheUUID;
+		} header;
+		if (cacheData.size() < sizeof(header)) {
+			return false;
+		}
+		std::memcpy(&header, cacheData.data(), sizeof(header));
+		return header.headerSize >= sizeof(header) && header.headerSize <= cacheData.size() &&
+			   header.headerVersion == static_cast<uint32_t>(vk::PipelineCacheHeaderVersion::eOne) &&
+			   header.vendorID == properties.vendorID &&
+			   header.deviceID == properties.deviceID &&
+			   std::equal(header.pipelineCacheUUID.begin(), header.pipelineCacheUUID.end(), properties.pipelineCacheUUID.begin());
+	}
+
+	void savePipelineCache() const {
+		const std::vector cacheData {device.getPipelineCacheData(pipelineCache)};
+		// I write to a temporary file and then rename it, so that a crash while writing can't leave a truncated cache behind
+		const std::filesystem::path temporaryPath {std::string(pipelineCacheFileName) + ".tmp"};
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(cacheData.data()), static_cast<std::streamsize>(cacheData.size()));
+		file.close();
+		std::error_code error;
+		if (!file.fail()) {
+			std::filesystem::rename(temporaryPath, pipelineCacheFileName, error);
+		}
+		if (file.fail() || error) {
+			std::clog << "Failed to save the pipeline cache\n";
+			std::filesystem::remove(temporaryPath, error);
+		}
+	}
+
+	void createRenderPass() {
+		const vk::AttachmentDescription colorAttachment({},
+			swapchainImageFormat,
+			vk::SampleCountFlagBits::e1,
+			vk::AttachmentLoadOp::eClear,						// Clear the image before drawing a new frame
+			vk::AttachmentStoreOp::eStore,						// Keep what I've rendered, 'cause I want to see it
+			vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,	// No stencil buffer
+			vk::ImageLayout::eUndefined,						// I don't care about the previous content, it gets cleared anyway
+			swapchain ? vk::ImageLayout::ePresentSrcKHR : vk::ImageLayout::eTransferSrcOptimal	// Offscreen images get read back instead
+		);
+		const vk::AttachmentReference colorAttachmentReference(0, vk::ImageLayout::eColorAttachmentOptimal);	// 0 is the index in the attachment array
+		const vk::SubpassDescription subpass({},
+			vk::PipelineBindPoint::eGraphics,
+			0, nullptr,											// Input attachments
+			1, &colorAttachmentReference
+		);
+		// The image layout transition at the start of the render pass must wait for the image to be acquired.
+		// The acquire semaphore is waited on at eColorAttachmentOutput, so the transition has to happen there too
+		const vk::SubpassDependency subpassDependency(
+			VK_SUBPASS_EXTERNAL, 0,
+			vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eColorAttachmentOutput,
+			{}, vk::AccessFlagBits::eColorAttachmentWrite
+		);
+
+		renderPass = device.createRenderPass(vk::RenderPassCreateInfo({}, 1, &colorAttachment, 1, &subpass, 1, &subpassDependency));
+	}
+
 	void createGraphicsPipeline() {
 		// Shaders are created during the creation of the pipeline, every time.
 		// I can destroy them here, I don't need to make them class members
 		const vk::ShaderModule vertShaderModule {createShaderModule(readFile("shaders/vert.spv"))};
 		const vk::ShaderModule fragShaderModule {createShaderModule(readFile("shaders/frag.spv"))};
 
-		// Maybe std::array?
-		const std::pair shaderStageInfos {
+		const std::array shaderStageInfos {
 			vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eVertex, vertShaderModule, "main"),
 			vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, fragShaderModule, "main")
 		};
@@ -481,14 +795,13 @@ private:
 		vk::PipelineVertexInputStateCreateInfo vertexInputInfo;
 
 		vk::PipelineInputAssemblyStateCreateInfo inputAssemblyInfo({},
-			vk::PrimitiveTopology::eTriangleList, true
+			vk::PrimitiveTopology::eTriangleList, false	// Primitive restart is only allowed with strip and fan topologies
 		);
 
-		vk::Viewport viewport(0.0F, 0.0F, static_cast<float>(swapchainExtent.width), static_cast<float>(swapchainExtent.height), 0.0F, 1.0F);
+		// Viewport and scissor are dynamic (they're set while recording), so that the pipeline doesn't depend on the swapchain extent.
 		// Things outside of the scissor rectangle will not get rendered
-		vk::Rect2D scissor({0, 0}, swapchainExtent);
 		vk::PipelineViewportStateCreateInfo viewportState({},
-			1, &viewport, 1, &scissor
+			1, nullptr, 1, nullptr
 		);
 
 		vk::PipelineRasterizationStateCreateInfo resterizerInfo({},
@@ -517,16 +830,157 @@ private:
 		);
 
 		// Used to dynamically change a few things of the (almost immutable) pipeline
-		std::array dynamicStates {vk::DynamicState::eViewport, vk::DynamicState::eLineWidth};
+		std::array dynamicStates {vk::DynamicState::eViewport, vk::DynamicState::eScissor, vk::DynamicState::eLineWidth};
 		vk::PipelineDynamicStateCreateInfo dynamicStateInfo({}, dynamicStates.size(), dynamicStates.data());
 
 		// Used to set the uniforms in the shaders
 		pipelineLayout = device.createPipelineLayout(vk::PipelineLayoutCreateInfo());
 
+		const vk::GraphicsPipelineCreateInfo pipelineInfo({},
+			shaderStageInfos.size(), shaderStageInfos.data(),
+			&vertexInputInfo,
+			&inputAssemblyInfo,
+			/*pTessellationState*/ nullptr,
+			&viewportState,
+			&resterizerInfo,
+			&multisamplingInfo,
+			/*pDepthStencilState*/ nullptr,
+			&colorBlendInfo,
+			&dynamicStateInfo,
+			pipelineLayout,
+			renderPass, /*subpass*/ 0
+		);
+
+		// Timed so that I can compare a cold start (no cache file) with a warm one.
+		// Mesa drivers (lavapipe included) keep their own shader cache too, MESA_SHADER_CACHE_DISABLE=true turns it off
+		const auto creationStart {std::chrono::steady_clock::now()};
+		if (device.createGraphicsPipelines(pipelineCache, 1, &pipelineInfo, nullptr, &graphicsPipeline) != vk::Result::eSuccess) {
+			throw std::runtime_error("Failed to create graphics pipeline");
+		}
+		const std::chrono::duration<double, std::milli> creationTime {std::chrono::steady_clock::now() - creationStart};
+		std::clog << "Graphics pipeline created in " << creationTime.count() << " ms (" << (pipelineCacheLoaded ? "warm" : "cold") << " pipeline cache)\n";
+
 		device.destroyShaderModule(vertShaderModule);
 		device.destroyShaderModule(fragShaderModule);
 	}
 
+	void createFramebuffers() {
+		swapchainFramebuffers.resize(swapchainImageViews.size());
+
+		for (size_t i {0}; i < swapchainFramebuffers.size(); ++i) {
+			swapchainFramebuffers[i] = device.createFramebuffer(
+				vk::FramebufferCreateInfo({},
+					renderPass,
+					1, &swapchainImageViews[i],
+					swapchainExtent.width, swapchainExtent.height,
+					/*layers*/ 1
+				)
+			);
+		}
+	}
+
+	void createFrameResources() {
+		const QueueFamilyIndices indices {findQueueFamilies(physicalDevice)};
+		frames.resize(options.framesInFlight);
+
+		for (FrameResources& frame : frames) {
+			// Transient because the command buffer gets recorded from scratch every frame
+			frame.commandPool = device.createCommandPool(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eTransient, indices.graphicsFamily.value()));
+			frame.commandBuffer = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(frame.commandPool, vk::CommandBufferLevel::ePrimary, 1)).front();
+			frame.imageAvailableSemaphore = device.createSemaphore(vk::SemaphoreCreateInfo());
+			frame.renderFinishedSemaphore = device.createSemaphore(vk::SemaphoreCreateInfo());
+			// Created already signaled, otherwise the first drawFrame() would wait forever
+			frame.inFlightFence = device.createFence(vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled));
+		}
+		imagesInFlight.assign(swapchainImages.size(), nullptr);
+	}
+
+	void drawFrame() {
+		const FrameResources& frame {frames[currentFrame]};
+		// The GPU has to be done with the last frame that used this slot before I can reuse its command buffer
+		waitForFence(frame.inFlightFence);
+		destroyRetiredSwapchains(frameNumber);
+
+		uint32_t imageIndex;
+		bool swapchainOutdated {framebufferResized};
+		if (swapchain) {
+			try {
+				const vk::ResultValue<uint32_t> acquired {device.acquireNextImageKHR(swapchain, std::numeric_limits<uint64_t>::max(), frame.imageAvailableSemaphore, nullptr)};
+				imageIndex = acquired.value;
+				// A suboptimal swapchain can still be used, so I render this frame anyway and recreate it afterwards
+				swapchainOutdated |= acquired.result == vk::Result::eSuboptimalKHR;
+			}
+			catch (const vk::OutOfDateKHRError&) {
+				// Nothing was acquired and the fence is still signaled, so I can just try again with a new swapchain
+				recreateSwapchain();
+				return;
+			}
+		}
+		else {
+			imageIndex = nextOffscreenImage;
+			nextOffscreenImage = (nextOffscreenImage + 1) % swapchainImages.size();
+		}
+
+		// The image could be acquired out of order, and a frame in another slot could still be rendering to it
+		if (imagesInFlight[imageIndex]) {
+			waitForFence(imagesInFlight[imageIndex]);
+		}
+		imagesInFlight[imageIndex] = frame.inFlightFence;
+
+		device.resetCommandPool(frame.commandPool, {});
+		recordCommandBuffer(frame.commandBuffer, imageIndex);
+
+		constexpr vk::PipelineStageFlags waitStage {vk::PipelineStageFlagBits::eColorAttachmentOutput};
+		// Offscreen images don't get acquired or presented, so there's nothing to wait for or to signal
+		const vk::SubmitInfo submitInfo(
+			swapchain ? 1 : 0, &frame.imageAvailableSemaphore, &waitStage,
+			1, &frame.commandBuffer,
+			swapchain ? 1 : 0, &frame.renderFinishedSemaphore
+		);
+		device.resetFences(frame.inFlightFence);
+		graphicsQueue.submit(submitInfo, frame.inFlightFence);
+
+		if (swapchain) {
+			try {
+				swapchainOutdated |= presentationQueue.presentKHR(vk::PresentInfoKHR(1, &frame.renderFinishedSemaphore, 1, &swapchain, &imageIndex)) == vk::Result::eSuboptimalKHR;
+			}
+			catch (const vk::OutOfDateKHRError&) {
+				swapchainOutdated = true;
+			}
+		}
+
+		currentFrame = (currentFrame + 1) % frames.size();
+		++frameNumber;
+		if (swapchain && swapchainOutdated) {
+			recreateSwapchain();
+		}
+	}
+
+	void recordCommandBuffer(const vk::CommandBuffer commandBuffer, const uint32_t imageIndex) const {
+		commandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+		const vk::ClearValue clearColor(vk::ClearColorValue(std::array{0.0F, 0.0F, 0.0F, 1.0F}));
+		commandBuffer.beginRenderPass(
+			vk::RenderPassBeginInfo(renderPass, swapchainFramebuffers[imageIndex], vk::Rect2D({0, 0}, swapchainExtent), 1, &clearColor),
+			vk::SubpassContents::eInline
+		);
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, graphicsPipeline);
+		// Dynamic states of the pipeline, they must be set before drawing
+		commandBuffer.setViewport(0, vk::Viewport(0.0F, 0.0F, static_cast<float>(swapchainExtent.width), static_cast<float>(swapchainExtent.height), 0.0F, 1.0F));
+		commandBuffer.setScissor(0, vk::Rect2D({0, 0}, swapchainExtent));
+		commandBuffer.setLineWidth(1.0F);
+		commandBuffer.draw(3, 1, 0, 0);	// The three vertices are hardcoded in the vertex shader
+		commandBuffer.endRenderPass();
+
+		commandBuffer.end();
+	}
+
+	void waitForFence(const vk::Fence fence) const {
+		if (device.waitForFences(fence, true, std::numeric_limits<uint64_t>::max()) != vk::Result::eSuccess) {
+			throw std::runtime_error("Failed to wait for fence");
+		}
+	}
+
 	static std::vector<std::byte> readFile(const std::string_view fileName) {
 		std::ifstream file(fileName.data(), std::ios::ate | std::ios::binary);	// Opened at the end to know the file size
 		if (!file.is_open()) {
@@ -552,10 +1006,32 @@ private:
 	}
 };
 
-int main() {
-	HelloTriangleApplication app;
+[[nodiscard]] static Options parseOptions(const int argc, const char* const argv[]) {
+	Options options;
+	for (int i {1}; i < argc; ++i) {
+		const std::string_view argument {argv[i]};
+		if (argument == "--headless") {
+			options.headless = true;
+		}
+		else if (argument == "--frames" && i + 1 < argc) {
+			options.frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (argument == "--frames-in-flight" && i + 1 < argc) {
+			options.framesInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+			if (options.framesInFlight == 0) {
+				throw std::runtime_error("At least one frame has to be in flight");
+			}
+		}
+		else {
+			throw std::runtime_error("Unknown argument: " + std::string(argument));
+		}
+	}
+	return options;
+}
 
+int main(int argc, char* argv[]) {
 	try {
+		HelloTriangleApplication app(parseOptions(argc, argv));
 		app.run();
 	} catch (const std::exception& e) {
 		std::clog << e.what() << '\n';
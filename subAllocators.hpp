@@ -0,0 +1,184 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+// The allocation strategies only work with offsets and sizes, they don't know anything about Vulkan.
+// This way they can be used to split any range: device memory blocks, but also a single big buffer.
+// Nothing in here includes vulkan.hpp, so the tests in tests/ run without a GPU or the SDK
+
+[[nodiscard]] constexpr uint64_t alignUp(const uint64_t value, const uint64_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// Just bumps an offset. Individual allocations can't be freed, everything goes away at once with reset()
+class LinearAllocator {
+public:
+	explicit LinearAllocator(const uint64_t size) : capacity(size) {}
+
+	[[nodiscard]] std::optional<uint64_t> allocate(const uint64_t size, const uint64_t alignment) {
+		const uint64_t offset {alignUp(head, alignment)};
+		if (offset + size > capacity) {
+			return std::nullopt;
+		}
+		head = offset + size;
+		return offset;
+	}
+
+	void reset() {
+		head = 0;
+	}
+
+	[[nodiscard]] uint64_t size() const { return capacity; }
+	[[nodiscard]] uint64_t usedBytes() const { return head; }
+
+private:
+	uint64_t capacity;
+	uint64_t head {0};
+};
+
+// A linear allocator that wraps around. Allocations have to be released in the same order they were made,
+// which is exactly what happens with per-frame data: mark() at the end of a frame, release() once the GPU is done with it
+class RingAllocator {
+public:
+	explicit RingAllocator(const uint64_t size) : capacity(size) {}
+
+	[[nodiscard]] std::optional<uint64_t> allocate(const uint64_t size, const uint64_t alignment) {
+		// head and tail only ever grow, the actual offset is their remainder. The alignment is for that offset, so it's applied
+		// from the start of the current lap: the capacity doesn't have to be a multiple of it. An allocation can't wrap around
+		// the end of the range, so if it doesn't fit before the end I skip to the start of the next lap, which is aligned to anything
+		const uint64_t lapStart {head - head % capacity};
+		uint64_t start {lapStart + alignUp(head - lapStart, alignment)};
+		if (start - lapStart + size > capacity) {
+			start = lapStart + capacity;
+		}
+		if (start + size - tail > capacity) {
+			return std::nullopt;
+		}
+		head = start + size;
+		return start % capacity;
+	}
+
+	// Everything allocated before this point can be released together
+	[[nodiscard]] uint64_t mark() const { return head; }
+
+	void release(const uint64_t mark) {
+		tail = std::max(tail, mark);
+	}
+
+	[[nodiscard]] uint64_t size() const { return capacity; }
+	[[nodiscard]] uint64_t usedBytes() const { return head - tail; }
+
+private:
+	uint64_t capacity;
+	uint64_t head {0};
+	uint64_t tail {0};
+};
+
+// Splits a power of two range in halves until it finds a block that's just big enough. A block is always aligned
+// to its size, so any power of two alignment up to the block size comes for free. Freed blocks get merged
+// back with their buddy (the other half they came from) as soon as it's free too
+class BuddyAllocator {
+public:
+	BuddyAllocator(const uint64_t size, const uint64_t minBlockSize) :
+		capacity(std::bit_floor(size)),
+		minBlockSize(std::bit_ceil(minBlockSize)),
+		freeBlocks(static_cast<size_t>(std::countr_zero(capacity) - std::countr_zero(this->minBlockSize)) + 1)
+	{
+		freeBlocks.back().insert(0);	// The biggest order is the whole range
+	}
+
+	[[nodiscard]] std::optional<uint64_t> allocate(const uint64_t size, const uint64_t alignment) {
+		const uint64_t blockSize {std::bit_ceil(std::max({size, alignment, minBlockSize}))};
+		if (blockSize > capacity) {
+			return std::nullopt;
+		}
+		const size_t order {orderOf(blockSize)};
+		size_t availableOrder {order};
+		while (availableOrder < freeBlocks.size() && freeBlocks[availableOrder].empty()) {
+			++availableOrder;
+		}
+		if (availableOrder == freeBlocks.size()) {
+			return std::nullopt;
+		}
+
+		// Lowest offset first, to keep the free space at the end of the range as much as possible
+		const uint64_t offset {*freeBlocks[availableOrder].begin()};
+		freeBlocks[availableOrder].erase(freeBlocks[availableOrder].begin());
+		// Splitting the block I found until it's the right size, the upper halves become free blocks
+		while (availableOrder > order) {
+			--availableOrder;
+			freeBlocks[availableOrder].insert(offset + sizeOf(availableOrder));
+		}
+		allocatedOrders.emplace(offset, order);
+		used += blockSize;
+		return offset;
+	}
+
+	void free(uint64_t offset) {
+		const auto allocated {allocatedOrders.find(offset)};
+		if (allocated == allocatedOrders.end()) {
+			throw std::logic_error("Freeing an offset that was never allocated");
+		}
+		size_t order {allocated->second};
+		allocatedOrders.erase(allocated);
+		used -= sizeOf(order);
+
+		while (order + 1 < freeBlocks.size()) {
+			const uint64_t buddy {offset ^ sizeOf(order)};
+			if (freeBlocks[order].erase(buddy) == 0) {
+				break;
+			}
+			offset = std::min(offset, buddy);
+			++order;
+		}
+		freeBlocks[order].insert(offset);
+	}
+
+	[[nodiscard]] uint64_t size() const { return capacity; }
+	[[nodiscard]] uint64_t usedBytes() const { return used; }
+	[[nodiscard]] bool empty() const { return allocatedOrders.empty(); }
+
+	[[nodiscard]] uint64_t largestFreeBlock() const {
+		for (size_t order {freeBlocks.size()}; order > 0; --order) {
+			if (!freeBlocks[order - 1].empty()) {
+				return sizeOf(order - 1);
+			}
+		}
+		return 0;
+	}
+
+private:
+	uint64_t capacity;
+	uint64_t minBlockSize;
+	uint64_t used {0};
+	std::vector<std::set<uint64_t>> freeBlocks;					// Offsets of the free blocks, one set for each order
+	std::unordered_map<uint64_t, size_t> allocatedOrders;		// Order of each allocated block, by offset
+
+	[[nodiscard]] size_t orderOf(const uint64_t blockSize) const {
+		return static_cast<size_t>(std::countr_zero(blockSize) - std::countr_zero(minBlockSize));
+	}
+
+	[[nodiscard]] uint64_t sizeOf(const size_t order) const {
+		return minBlockSize << order;
+	}
+};
+
+// Buffers and optimal-tiling images that sit too close to each other in the same vk::DeviceMemory
+// alias according to bufferImageGranularity. Keeping them in separate blocks avoids the issue altogether
+enum class ResourceKind {
+	eLinear,	// Buffers and linear-tiling images
+	eOptimal	// Optimal-tiling images
+};
+
+// DeviceAllocator keeps two pools of blocks for each memory type. With a granularity above 1 the optimal-tiling images
+// get the second one, with a granularity of 1 buffers and images can share the same blocks
+[[nodiscard]] constexpr size_t poolIndex(const uint32_t memoryType, const uint64_t bufferImageGranularity, const ResourceKind kind) {
+	return size_t {memoryType} * 2 + (bufferImageGranularity > 1 && kind == ResourceKind::eOptimal ? 1 : 0);
+}
@@ -0,0 +1,181 @@
+// The allocation strategies of subAllocators.hpp on their own, no Vulkan needed. Run with ctest
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+#include "../subAllocators.hpp"
+
+static int failures {0};
+
+// Not assert(), so that the checks stay in release builds too
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::cerr << __FILE__ << ':' << __LINE__ << ": " #condition " failed\n"; \
+			++failures; \
+		} \
+	} while (false)
+
+static void testAlignUp() {
+	CHECK(alignUp(0, 16) == 0);
+	CHECK(alignUp(1, 16) == 16);
+	CHECK(alignUp(16, 16) == 16);
+	CHECK(alignUp(17, 256) == 256);
+	CHECK(alignUp(5, 1) == 5);
+}
+
+static void testLinearAllocator() {
+	LinearAllocator allocator(256);
+	CHECK(allocator.allocate(3, 1) == std::optional<uint64_t> {0});
+	// Aligned up past the first allocation
+	CHECK(allocator.allocate(8, 16) == std::optional<uint64_t> {16});
+	CHECK(allocator.usedBytes() == 24);
+	CHECK(allocator.allocate(232, 1) == std::optional<uint64_t> {24});
+	CHECK(allocator.usedBytes() == 256);
+	// Full, and a failed allocation doesn't move anything
+	CHECK(!allocator.allocate(1, 1));
+	CHECK(allocator.usedBytes() == 256);
+	allocator.reset();
+	CHECK(allocator.usedBytes() == 0);
+	CHECK(allocator.allocate(256, 256) == std::optional<uint64_t> {0});
+	CHECK(!allocator.allocate(1, 1));
+}
+
+static void testRingAllocator() {
+	RingAllocator allocator(256);
+	CHECK(allocator.allocate(100, 1) == std::optional<uint64_t> {0});
+	const uint64_t firstFrame {allocator.mark()};
+	CHECK(allocator.allocate(100, 4) == std::optional<uint64_t> {100});
+	const uint64_t secondFrame {allocator.mark()};
+	CHECK(allocator.usedBytes() == 200);
+
+	// Doesn't fit before the end, and the start is still taken by the first frame
+	CHECK(!allocator.allocate(100, 1));
+	// Once the first frame is released it goes to the start instead of wrapping around the end
+	allocator.release(firstFrame);
+	CHECK(allocator.allocate(100, 1) == std::optional<uint64_t> {0});
+	// The 56 bytes skipped at the end count as used until the second frame is released
+	CHECK(allocator.usedBytes() == 256);
+	CHECK(!allocator.allocate(1, 1));
+
+	// Releasing an older mark again does nothing
+	allocator.release(firstFrame);
+	CHECK(allocator.usedBytes() == 256);
+	allocator.release(secondFrame);
+	CHECK(allocator.usedBytes() == 156);
+	allocator.release(allocator.mark());
+	CHECK(allocator.usedBytes() == 0);
+
+	// Alignment applies to the offset in the range, after the wrap too
+	const std::optional<uint64_t> aligned {allocator.allocate(10, 64)};
+	CHECK(aligned && *aligned % 64 == 0);
+	CHECK(!allocator.allocate(257, 1));
+}
+
+// Like the staging ring, whose size depends on the draw count
+static void testRingAllocatorUnalignedCapacity() {
+	RingAllocator allocator(100);
+	CHECK(allocator.allocate(40, 16) == std::optional<uint64_t> {0});
+	CHECK(allocator.allocate(40, 16) == std::optional<uint64_t> {48});
+	allocator.release(allocator.mark());
+	// 96 + 20 doesn't fit, so it goes to the start of the second lap
+	CHECK(allocator.allocate(20, 16) == std::optional<uint64_t> {0});
+	// The head is at 120 but the offset is 20, aligning the head would give 28
+	CHECK(allocator.allocate(10, 16) == std::optional<uint64_t> {32});
+	allocator.release(allocator.mark());
+	for (uint32_t i {0}; i < 50; ++i) {
+		const std::optional<uint64_t> offset {allocator.allocate(24, 16)};
+		CHECK(offset && *offset % 16 == 0 && *offset + 24 <= 100);
+		allocator.release(allocator.mark());
+	}
+}
+
+static void testBuddyAllocator() {
+	BuddyAllocator allocator(1024, 64);
+	CHECK(allocator.size() == 1024);
+	CHECK(allocator.empty());
+
+	// The first one splits the whole range down to 64, the second one takes its buddy
+	const std::optional<uint64_t> a {allocator.allocate(50, 1)};
+	const std::optional<uint64_t> b {allocator.allocate(64, 1)};
+	CHECK(a == std::optional<uint64_t> {0});
+	CHECK(b == std::optional<uint64_t> {64});
+	CHECK(allocator.usedBytes() == 128);
+	CHECK(allocator.largestFreeBlock() == 512);
+
+	// Rounded up to a power of two, and aligned to its size
+	const std::optional<uint64_t> c {allocator.allocate(100, 1)};
+	CHECK(c == std::optional<uint64_t> {128});
+	const std::optional<uint64_t> d {allocator.allocate(16, 256)};
+	CHECK(d && *d % 256 == 0);
+	CHECK(d == std::optional<uint64_t> {256});
+
+	// The buddies merge back into the whole range, whatever the order they're freed in
+	allocator.free(*b);
+	allocator.free(*d);
+	allocator.free(*a);
+	CHECK(allocator.largestFreeBlock() == 512);	// c still splits the lower half
+	allocator.free(*c);
+	CHECK(allocator.empty());
+	CHECK(allocator.usedBytes() == 0);
+	CHECK(allocator.largestFreeBlock() == 1024);
+
+	bool threw {false};
+	try {
+		allocator.free(128);
+	}
+	catch (const std::logic_error&) {
+		threw = true;
+	}
+	CHECK(threw);
+}
+
+static void testBuddyExhaustion() {
+	BuddyAllocator allocator(1024, 64);
+	CHECK(!allocator.allocate(2048, 1));
+	CHECK(!allocator.allocate(1, 2048));	// An alignment bigger than the range can't be satisfied either
+	std::vector<uint64_t> offsets;
+	for (uint32_t i {0}; i < 16; ++i) {
+		const std::optional<uint64_t> offset {allocator.allocate(1, 1)};
+		CHECK(offset.has_value());
+		if (offset) {
+			offsets.push_back(*offset);
+		}
+	}
+	CHECK(!allocator.allocate(1, 1));
+	CHECK(allocator.largestFreeBlock() == 0);
+	// Two neighbouring blocks that aren't buddies (64 and 128) don't make room for a 128 one
+	allocator.free(64);
+	allocator.free(128);
+	CHECK(!allocator.allocate(128, 1));
+	allocator.free(192);
+	CHECK(allocator.allocate(128, 1) == std::optional<uint64_t> {128});
+}
+
+static void testPoolIndex() {
+	// With a granularity of 1 buffers and images share a pool
+	CHECK(poolIndex(0, 1, ResourceKind::eLinear) == poolIndex(0, 1, ResourceKind::eOptimal));
+	// Otherwise the optimal-tiling images get one of their own
+	CHECK(poolIndex(0, 1024, ResourceKind::eLinear) != poolIndex(0, 1024, ResourceKind::eOptimal));
+	CHECK(poolIndex(3, 1024, ResourceKind::eLinear) == 6);
+	CHECK(poolIndex(3, 1024, ResourceKind::eOptimal) == 7);
+	// And no two memory types end up in the same pool
+	CHECK(poolIndex(1, 1024, ResourceKind::eLinear) != poolIndex(0, 1024, ResourceKind::eOptimal));
+}
+
+int main() {
+	testAlignUp();
+	testLinearAllocator();
+	testRingAllocator();
+	testRingAllocatorUnalignedCapacity();
+	testBuddyAllocator();
+	testBuddyExhaustion();
+	testPoolIndex();
+	if (failures != 0) {
+		std::cerr << failures << " checks failed\n";
+		return 1;
+	}
+	std::cout << "All sub-allocator checks passed\n";
+	return 0;
+}